@@ -0,0 +1,227 @@
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+
+#include "ConsoleDisplay.h"
+#include "TetrisSolver.h"
+
+// Measures how the per move work scales with the matrix size:
+//   ConsoleTetrisBench [iterations]
+// Rendering goes through curses into /dev/null.
+// Fails when the solver misses a known solution.
+
+using namespace std;
+
+static vector<Tetrimino> blocks() {
+    return {Tetrimino({{0, 0, 0},
+                       {1, 1, 1},
+                       {0, 0, 1}}, 6),
+            Tetrimino({{0, 0, 0},
+                       {1, 1, 1},
+                       {1, 0, 0}}, 7),
+            Tetrimino({{0, 0, 0},
+                       {1, 1, 0},
+                       {0, 1, 1}}, 1),
+            Tetrimino({{0, 0, 0},
+                       {0, 1, 1},
+                       {1, 1, 0}}, 8),
+            Tetrimino({{0, 0, 0},
+                       {1, 1, 1},
+                       {0, 1, 0}}, 3),
+            Tetrimino({{0, 0, 0, 0},
+                       {1, 1, 1, 1},
+                       {0, 0, 0, 0},
+                       {0, 0, 0, 0}}, 2),
+            Tetrimino({{1, 1},
+                       {1, 1}}, 4)};
+}
+
+static const int Z_BLOCK = 2;
+static const int I_BLOCK = 5;
+
+class BenchSim : public TetrisSim {
+public:
+    BenchSim(int width, int height, int preview = TETRIS_INCOMING_LOOK_AHEAD) :
+        TetrisSim(blocks(), width, height, TetrisRandom::uniform, preview) {}
+
+    // Random cells in the lower half, leaving every row a hole
+    void fillGarbage() {
+        mt19937 rand(1);
+        for(int i = m_height/2; i < m_height; ++i) {
+            for(int j = 0; j < m_width; ++j)
+                set(i, j, rand() % 3 != 0);
+            set(i, rand() % m_width, false);
+        }
+        newBlock(0);
+        updateGhost();
+    }
+
+    void set(int y, int x, bool on) {
+        m_cup[4 + y][x] = on ? 1 : 0;
+        if(on)
+            m_rows[4 + y] |= 1ull << x;
+        else
+            m_rows[4 + y] &= ~(1ull << x);
+    }
+
+    // The I has to wait in the hold until the Z is down, which is only after
+    // the single preview piece has been used up
+    bool checkHoldLast() {
+        while(m_queue.peek(0) != Z_BLOCK)
+            m_queue.next();
+        m_hold = -1;
+        newBlock(I_BLOCK);
+        for(int j = 0; j < m_width; ++j) {
+            set(m_height - 2, j, j >= 6);
+            set(m_height - 1, j, j != 1 && j != 2);
+        }
+        updateGhost();
+
+        TetrisSolver solver(*this);
+        solver.setTimeLimit(chrono::milliseconds(0));
+        auto res = solver.perfectClear();
+        if(!res.m_found)
+            return false;
+        for(auto& move : res.m_moves) {
+            for(auto a : move.m_acts)
+                act(a);
+            while(m_state & (BV(TetrisState::blockFalling) | BV(TetrisState::lineClearing)))
+                tick();
+        }
+        return all_of(m_rows.begin(), m_rows.end(), [](uint64_t row) { return row == 0; });
+    }
+
+    uint64_t benchCheck(int iterations) {
+        mt19937 rand(2);
+        uint64_t hits = 0;
+        for(int k = 0; k < iterations; ++k) {
+            int type = rand() % m_blocks.size();
+            hits += check(type, rand() % m_width - 1, rand() % m_height - 2, rand() % 4);
+        }
+        return hits;
+    }
+
+    uint64_t benchGhost(int iterations) {
+        uint64_t sum = 0;
+        for(int k = 0; k < iterations; ++k) {
+            m_tY = -2;
+            updateGhost();
+            sum += m_ghostY;
+        }
+        return sum;
+    }
+
+    // Drops a vertical I into a 4 row well and removes the lines
+    chrono::nanoseconds benchClear(int iterations) {
+        chrono::nanoseconds total{0};
+        for(int k = 0; k < iterations; ++k) {
+            int well = k % m_width;
+            for(int i = m_height - 4; i < m_height; ++i) {
+                for(int j = 0; j < m_width; ++j)
+                    set(i, j, j != well);
+            }
+            m_tType = I_BLOCK;
+            m_tRot = 1;
+            m_tX = well - 2;
+            m_tY = m_height - 4;
+            m_state = 0;
+
+            auto start = chrono::steady_clock::now();
+            finalize();
+            m_finishProgress = 0;
+            tick();
+            total += chrono::steady_clock::now() - start;
+        }
+        return total;
+    }
+};
+
+class BenchDisplay : public ConsoleDisplay {
+public:
+    BenchDisplay(int width, int height) :
+        ConsoleDisplay(width, height) {}
+
+    void load(BenchSim& sim) {
+        m_sim = sim;
+    }
+};
+
+template<class Func>
+static double nsPerOp(int iterations, Func func) {
+    auto start = chrono::steady_clock::now();
+    func();
+    return double(chrono::duration_cast<chrono::nanoseconds>(
+        chrono::steady_clock::now() - start).count()) / iterations;
+}
+
+int main(int argc, char** argv) {
+    int iterations = 100000;
+    if(argc >= 2) {
+        char* end;
+        long n = strtol(argv[1], &end, 10);
+        if(end == argv[1] || *end || n < 1 || n > INT_MAX) {
+            fprintf(stderr, "usage: %s [iterations > 0]\n", argv[0]);
+            return 1;
+        }
+        iterations = n;
+    }
+
+    BenchSim holdLast(10, 20, 1);
+    if(!holdLast.checkHoldLast()) {
+        fprintf(stderr, "solver: missed a perfect clear playing the held piece last\n");
+        return 1;
+    }
+    const int SIZES[][2] = {{10, 20}, {16, 40}, {32, 100}, {64, 250}, {64, 1000}};
+
+    // Large enough for every matrix to be drawn whole
+    setenv("LINES", "1010", 1);
+    setenv("COLUMNS", "200", 1);
+    if(!getenv("TERM"))
+        setenv("TERM", "xterm", 1);
+
+    struct Row {
+        double check, ghost, clear, redraw;
+    };
+    vector<Row> rows;
+    uint64_t sink = 0;
+
+    for(auto& size : SIZES) {
+        BenchSim sim(size[0], size[1]);
+        sim.fillGarbage();
+        Row row;
+        row.check = nsPerOp(iterations, [&]() { sink += sim.benchCheck(iterations); });
+        int moves = max(1, iterations/10);
+        row.ghost = nsPerOp(moves, [&]() { sink += sim.benchGhost(moves); });
+        row.clear = double(sim.benchClear(moves).count()) / moves;
+
+        BenchSim drawn(size[0], size[1]);
+        drawn.fillGarbage();
+        auto out = dup(fileno(stdout));
+        freopen("/dev/null", "w", stdout);
+        {
+            BenchDisplay display(size[0], size[1]);
+            display.load(drawn);
+            int frames = max(1, iterations/1000);
+            row.redraw = nsPerOp(frames, [&]() {
+                for(int k = 0; k < frames; ++k)
+                    display.redraw();
+            });
+        }
+        fflush(stdout);
+        dup2(out, fileno(stdout));
+        close(out);
+        rows.push_back(row);
+    }
+
+    printf("%-10s %12s %12s %12s %12s\n", "matrix", "check ns", "ghost ns", "clear ns", "redraw us");
+    for(size_t i = 0; i < rows.size(); ++i) {
+        char name[16];
+        snprintf(name, sizeof(name), "%ix%i", SIZES[i][0], SIZES[i][1]);
+        printf("%-10s %12.1f %12.1f %12.1f %12.1f\n", name,
+               rows[i].check, rows[i].ghost, rows[i].clear, rows[i].redraw / 1000);
+    }
+    printf("(checksum %llu)\n", (unsigned long long)sink);
+    return 0;
+}
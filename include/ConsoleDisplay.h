@@ -1,10 +1,13 @@
 #ifndef CONSOLEDISPLAY_H
 #define CONSOLEDISPLAY_H
 
+#include <future>
 #include <unordered_map>
 #include <ncursesw/curses.h>
 
+#include "TetrisRecords.h"
 #include "TetrisSim.h"
+#include "TetrisSolver.h"
 
 // Defined color pairs
 // 1     2   3     4      5    6       7    8
@@ -12,6 +15,10 @@
 #define BG_COLOR COLOR_BLUE
 #define DEF_COLOR_PAIR COLOR_PAIR(8)
 
+// Columns kept for the stats and hold on the left of the matrix
+// and the incoming blocks on the right
+#define PANEL_WIDTH 24
+
 #define mvaddwch(y, x, ch) { wchar_t str[] = {(ch), '\0'}; mvaddwstr((y), (x), str); }
 
 /*
@@ -48,10 +55,12 @@
 LINES└─────────────────────────┴──────────────────────────┴─────────────────────────┘
  */
 
-#define Y1 (LINES - TETRIS_MATRIX_HEIGHT - 2)/2
-#define X1 (COLS - TETRIS_MATRIX_WIDTH - 2)/2
-#define Y2 ((LINES + TETRIS_MATRIX_HEIGHT + 2)/2 - 1)
-#define X2 ((COLS + TETRIS_MATRIX_WIDTH + 2)/2 - 1)
+// Only the part of the matrix that fits on the screen is shown,
+// so these refer to ConsoleDisplay::m_viewHeight and m_viewWidth
+#define Y1 (LINES - m_viewHeight - 2)/2
+#define X1 (COLS - m_viewWidth - 2)/2
+#define Y2 ((LINES + m_viewHeight + 2)/2 - 1)
+#define X2 ((COLS + m_viewWidth + 2)/2 - 1)
 
 class NCWindow {
 public:
@@ -76,17 +85,40 @@ protected:
 class ConsoleDisplay
 {
 public:
-    ConsoleDisplay();
+    ConsoleDisplay(int width = TETRIS_MATRIX_WIDTH, int height = TETRIS_MATRIX_HEIGHT,
+                   TetrisRandom random = TetrisRandom::uniform, int preview = TETRIS_INCOMING_LOOK_AHEAD);
     ~ConsoleDisplay();
 
+    void openRecords(const std::string& path, const std::string& player);
     void tick();
     void redraw();
     void drawTetrimino(int y, int x, Tetrimino& piece);
     void drawIncoming();
     void drawScores();
+    void requestHint();
+    void pollHint();
+    void drawHint(const char* text);
+    void drawStat(int line, const char* text);
+    void saveGame();
 
 protected:
+    int m_width;
+    int m_height;
+    TetrisRandom m_random;
+    int m_preview;
+    int m_viewWidth;
+    int m_viewHeight;
+    int m_viewTop = 0;
+    int m_viewLeft = 0;
     NCWindow m_tetrisWindow;
+    TetrisRecords m_records;
+    std::string m_player;
+    // Perfect clear search running in the background
+    std::future<SolverResult> m_hint;
+    // Blocks taken so far, tells whether a hint is still about the current one
+    uint64_t m_blockCount = 0;
+    uint64_t m_hintBlock = 0;
+    bool m_hintAgain = false;
     TetrisSim m_sim{{Tetrimino({{0, 0, 0},
                                 {1, 1, 1},
                                 {0, 0, 1}}, 6),
@@ -107,7 +139,8 @@ protected:
                                 {0, 0, 0, 0},
                                 {0, 0, 0, 0}}, 2),
                      Tetrimino({{1, 1},
-                                {1, 1}}, 4)}};
+                                {1, 1}}, 4)},
+                    m_width, m_height, m_random, m_preview};
     std::unordered_map<char, TetrisAct> m_keyToAct = {{KEY_LEFT, TetrisAct::left},
                                                       {KEY_RIGHT, TetrisAct::right},
                                                       {KEY_DOWN, TetrisAct::down},
@@ -0,0 +1,97 @@
+#ifndef TETRISRANDOMIZER_H
+#define TETRISRANDOMIZER_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#define TETRIS_RANDOMIZER_BLOCK 256
+// Pieces remembered by the history randomizer and rerolls before giving up
+#define TETRIS_HISTORY_SIZE 4
+#define TETRIS_HISTORY_TRIES 4
+
+enum class TetrisRandom {
+    uniform = 0,
+    bag,
+    history
+};
+
+// Piece sequences are produced in blocks. A block only depends on the seed
+// and its number, so any part of a sequence can be generated without
+// replaying what comes before it.
+class TetrisRandomizer {
+public:
+    TetrisRandomizer(int pieces, uint64_t seed);
+    virtual ~TetrisRandomizer() = default;
+
+    virtual size_t blockSize() const = 0;
+    virtual void generate(uint64_t block, int* out) const = 0;
+
+    static std::shared_ptr<const TetrisRandomizer> create(TetrisRandom kind, int pieces, uint64_t seed);
+
+protected:
+    int m_pieces;
+    uint64_t m_seed;
+
+    // Random value number `index` of the seed
+    uint64_t draw(uint64_t index, uint64_t stream = 0) const;
+    static int range(uint64_t value, int n);
+};
+
+// Every piece is drawn on its own
+class UniformRandomizer : public TetrisRandomizer {
+public:
+    using TetrisRandomizer::TetrisRandomizer;
+
+    size_t blockSize() const override;
+    void generate(uint64_t block, int* out) const override;
+};
+
+// Every block is a shuffled set of all the pieces
+class BagRandomizer : public TetrisRandomizer {
+public:
+    using TetrisRandomizer::TetrisRandomizer;
+
+    size_t blockSize() const override;
+    void generate(uint64_t block, int* out) const override;
+};
+
+// Rerolls pieces found among the last few ones.
+// The history is carried within a block, each block starts from its own
+// history drawn from the seed.
+class HistoryRandomizer : public TetrisRandomizer {
+public:
+    using TetrisRandomizer::TetrisRandomizer;
+
+    size_t blockSize() const override;
+    void generate(uint64_t block, int* out) const override;
+};
+
+// Upcoming pieces kept in a ring buffer, refilled a whole block at a time
+// so that at least `depth` pieces are always known.
+class TetrisPieceQueue {
+public:
+    TetrisPieceQueue(std::shared_ptr<const TetrisRandomizer> rand, size_t depth);
+
+    int next();
+    // n-th upcoming piece, n < depth()
+    int peek(size_t n);
+    // Continue the sequence from its index-th piece
+    void seek(uint64_t index);
+    uint64_t position();
+    size_t depth();
+
+protected:
+    std::shared_ptr<const TetrisRandomizer> m_rand;
+    std::vector<int> m_ring;
+    std::vector<int> m_block;
+    size_t m_mask;
+    size_t m_depth;
+    // Absolute index of the next piece and of the first one not generated yet
+    uint64_t m_head = 0;
+    uint64_t m_end = 0;
+
+    void fill();
+};
+
+#endif // TETRISRANDOMIZER_H
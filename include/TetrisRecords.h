@@ -0,0 +1,139 @@
+#ifndef TETRISRECORDS_H
+#define TETRISRECORDS_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define TETRIS_RECORDS_MAGIC 0x5344524F43455254ull
+// Version 1 didn't checksum m_random, its stores are upgraded on open
+#define TETRIS_RECORDS_VERSION 2
+#define TETRIS_RECORDS_NAME 16
+// Length of the kept leaderboard
+#define TETRIS_RECORDS_TOP 1024
+#define TETRIS_RECORDS_INITIAL 1024
+#define TETRIS_RECORDS_INITIAL_PLAYERS 64
+
+// One finished game, stored as is in the data file
+struct GameRecord {
+    int32_t m_score = 0;
+    int32_t m_lines = 0;
+    int32_t m_level = 0;
+    int32_t m_maxCombo = 0;
+    uint32_t m_duration = 0; // ms
+    uint32_t m_seed = 0;
+    int64_t m_time = 0;      // seconds since epoch
+    char m_player[TETRIS_RECORDS_NAME] = {};
+    // Previous game of the same player, -1 for the first one. Set by TetrisRecords.
+    int64_t m_prevByPlayer = -1;
+    uint32_t m_check = 0;
+    // TetrisRandom the pieces were drawn with, together with m_seed gives the sequence
+    uint32_t m_random = 0;
+
+    void setPlayer(const std::string& name);
+    std::string getPlayer() const;
+};
+
+// Append only store of finished games.
+// Games go to <path>.dat, the leaderboard and the per player chains to <path>.idx.
+// Both are memory mapped. The index can always be rebuilt from the data file,
+// so it is only trusted when it was closed cleanly.
+// add() only queues the game, writing and syncing happens on a separate thread.
+// A store is open in a single process at a time, open() fails while another has it.
+class TetrisRecords {
+public:
+    TetrisRecords();
+    ~TetrisRecords();
+
+    bool open(const std::string& path);
+    void close();
+    bool isOpen();
+
+    void add(const GameRecord& record);
+    // Wait until everything added so far is on disk
+    void flush();
+
+    size_t size();
+    // Best n games, highest score first
+    std::vector<GameRecord> top(size_t n);
+    // Last n games of the player, newest first
+    std::vector<GameRecord> history(const std::string& player, size_t n);
+
+protected:
+    struct DataHeader {
+        uint64_t m_magic;
+        uint32_t m_version;
+        uint32_t m_recordSize;
+        uint64_t m_count;
+        uint64_t m_reserved[5];
+    };
+
+    struct TopEntry {
+        int64_t m_score;
+        int64_t m_record;
+    };
+
+    struct PlayerSlot {
+        char m_name[TETRIS_RECORDS_NAME];
+        int64_t m_last;
+        uint32_t m_games;
+        int32_t m_best;
+    };
+
+    struct IndexHeader {
+        uint64_t m_magic;
+        uint32_t m_version;
+        uint32_t m_dirty;
+        uint64_t m_covered;
+        uint64_t m_top;
+        uint64_t m_playerCapacity;
+        uint64_t m_players;
+        uint64_t m_reserved[2];
+    };
+
+    int m_dataFd = -1;
+    int m_indexFd = -1;
+    char* m_data = nullptr;
+    size_t m_dataSize = 0;
+    char* m_index = nullptr;
+    size_t m_indexSize = 0;
+    // Records written to the map, might not be synced yet
+    uint64_t m_count = 0;
+
+    // Guards the maps against being moved while they are read
+    std::shared_mutex m_mapMutex;
+
+    std::thread m_writer;
+    std::mutex m_queueMutex;
+    std::condition_variable m_queueCond;
+    std::condition_variable m_doneCond;
+    std::deque<GameRecord> m_queue;
+    bool m_writing = false;
+    bool m_stop = false;
+
+    DataHeader* dataHeader();
+    GameRecord* record(uint64_t i);
+    IndexHeader* indexHeader();
+    TopEntry* topEntries();
+    PlayerSlot* playerSlots();
+
+    void writerLoop();
+    void write(std::deque<GameRecord>& batch);
+    bool mapData(size_t capacity);
+    bool mapIndex(size_t playerCapacity);
+    void rebuildIndex();
+    void markDirty();
+    bool indexSane();
+    void indexRecord(uint64_t i);
+    PlayerSlot* findPlayer(const char* name, bool create);
+    void growPlayers();
+
+    static uint32_t checksum(const GameRecord& record, uint32_t version = TETRIS_RECORDS_VERSION);
+    static uint64_t hashName(const char* name);
+};
+
+#endif // TETRISRECORDS_H
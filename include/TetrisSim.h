@@ -5,9 +5,15 @@
 #include <vector>
 #include <random>
 
+#include "TetrisRandomizer.h"
+
 #define TETRIS_MATRIX_WIDTH 10
 #define TETRIS_MATRIX_HEIGHT 20
+// Rows are kept as 64 bit masks
+#define TETRIS_MATRIX_MAX_WIDTH 64
+#define TETRIS_MATRIX_MAX_HEIGHT 1000
 #define TETRIS_INCOMING_LOOK_AHEAD 5
+#define TETRIS_PREVIEW_MAX 4096
 
 #define MAX_LEVEL 100
 #define LEVEL_TO_SPEED(level) (1100 - 10*(level))
@@ -47,39 +53,63 @@ public:
     size_t m_dim;
     unsigned char m_color = 1;
     std::vector<std::vector<std::vector<bool>>> m_shape{4};
+    // Same as m_shape, one bit per column
+    std::vector<std::vector<uint64_t>> m_mask{4};
 protected:
 };
 
 class TetrisSim {
 public:
-    TetrisSim(std::vector<Tetrimino>&& blocks);
+    TetrisSim(std::vector<Tetrimino>&& blocks,
+              int width = TETRIS_MATRIX_WIDTH, int height = TETRIS_MATRIX_HEIGHT,
+              TetrisRandom random = TetrisRandom::uniform, int preview = TETRIS_INCOMING_LOOK_AHEAD);
     TetrisSim(TetrisSim& in);
 
     bool act(TetrisAct a);
     uint8_t cup(int y, int x);
     uint8_t getColor();
     Tetrimino& incoming(int N);
+    int getPreview();
     uint64_t tick();
     Tetrimino& getHeld();
     int getFinishedLines();
     int getCombo();
     int getLevel();
     int getScore();
+    int getMaxCombo();
+    uint32_t getSeed();
+    TetrisRandom getRandom();
+    // Index of the last block taken from the piece sequence of the seed
+    uint64_t getPieceIndex();
+    uint32_t getDuration();
+    int getWidth();
+    int getHeight();
+    int getX();
+    int getY();
+
+    friend class TetrisSolver;
 
 protected:
-    std::vector<std::vector<uint8_t>> m_cup =
-        std::vector<std::vector<uint8_t>>
-        (TETRIS_MATRIX_HEIGHT + 4, std::vector<uint8_t>(TETRIS_MATRIX_WIDTH, 0));
+    int m_width;
+    int m_height;
+    uint64_t m_fullRow;
+
+    std::vector<std::vector<uint8_t>> m_cup;
+    // Occupied cells of m_cup
+    std::vector<uint64_t> m_rows;
     std::vector<Tetrimino> m_blocks;
 
+    TetrisRandom m_random;
+    uint32_t m_seed;
+    TetrisPieceQueue m_queue;
+
     int m_tType = 0;
     int m_tX = 0;
     int m_tY = -1;
     int m_tRot = 0;
     int m_ghostY = 0;
 
-    std::mt19937 m_rand;
-
+    std::chrono::steady_clock::time_point m_startTime = std::chrono::steady_clock::now();
     std::chrono::steady_clock::time_point m_prevTime = std::chrono::steady_clock::now();
     uint64_t m_update = 0;
     uint64_t m_state = 0;
@@ -90,11 +120,9 @@ protected:
 
     int m_hold = -1;
 
-    int m_incoming[TETRIS_INCOMING_LOOK_AHEAD];
-    int m_incomingN = 0;
-
     int m_finishedLines = 0;
     int m_combo = 0;
+    int m_maxCombo = 0;
     int m_level = 1;
     int m_score = 0;
 
@@ -0,0 +1,186 @@
+#ifndef TETRISSOLVER_H
+#define TETRISSOLVER_H
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+
+#include "TetrisSim.h"
+
+// Upper bound for the memory spent on remembering already seen positions
+#define TETRIS_SOLVER_DEFAULT_MEMORY (64u << 20)
+// Heap cost of a single remembered position: the hash set node with its
+// malloc header. The bucket array is counted separately.
+#define TETRIS_SOLVER_NODE_BYTES 32
+#define TETRIS_SOLVER_SHARDS 64
+// Placements searched unless asked otherwise, the preview can be much deeper
+#define TETRIS_SOLVER_HORIZON 6
+// Time given to a search unless asked otherwise, ms
+#define TETRIS_SOLVER_DEFAULT_TIME 100
+
+// A single placement of the solution.
+// m_acts is the key sequence for TetrisSim::act() that leads to the placement,
+// starting right after the previous piece was locked.
+struct SolverMove {
+    bool m_hold = false;
+    int m_type = 0;
+    int m_x = 0;
+    int m_y = 0;
+    int m_rot = 0;
+    int m_lines = 0;
+    std::vector<TetrisAct> m_acts;
+};
+
+// When the search ran out of time, m_found = false only means that nothing
+// was found in time.
+struct SolverResult {
+    bool m_found = false;
+    std::vector<SolverMove> m_moves;
+    size_t m_visited = 0;
+    bool m_memoryCapped = false;
+    bool m_timedOut = false;
+};
+
+// Searches placements of the active piece, the held piece and the known
+// incoming pieces of a TetrisSim snapshot.
+// Pieces are moved with the same rules as TetrisSim (including rotation fitting),
+// gravity is not taken into account.
+class TetrisSolver {
+public:
+    TetrisSolver(TetrisSim& sim);
+
+    // Is it possible to clear the whole matrix using at most maxPieces placements?
+    // maxPieces < 0 stands for every known piece, up to TETRIS_SOLVER_HORIZON.
+    SolverResult perfectClear(int maxPieces = -1);
+    // Is it possible to clear at least `lines` lines using at most maxPieces placements?
+    SolverResult clearLines(int lines, int maxPieces = -1);
+
+    void setThreads(unsigned threads);
+    void setMemoryLimit(size_t bytes);
+    // 0 searches until the answer is known
+    void setTimeLimit(std::chrono::milliseconds limit);
+
+protected:
+    struct Shape {
+        int m_dim = 0;
+        int m_minCol = 0;
+        int m_maxCol = 0;
+        int m_minRow = 0;
+        int m_maxRow = 0;
+        uint64_t m_rows[4] = {};
+    };
+
+    struct Board {
+        std::vector<uint64_t> m_rows;
+        int m_cells = 0;
+    };
+
+    struct Placement {
+        int m_x, m_y, m_rot;
+    };
+
+    // Everything about a position apart from the matrix
+    struct State {
+        int m_queueN;
+        int m_cur;
+        int m_hold;
+        int m_lines;
+        int m_missing = 0;
+        uint64_t m_hash = 0;
+    };
+
+    struct Node {
+        Board m_board;
+        State m_state;
+    };
+
+    struct Step {
+        bool m_hold;
+        int m_type;
+        Placement m_place;
+        int m_lines;
+    };
+
+    struct Child {
+        State m_state;
+        Step m_step;
+    };
+
+    // Buffers reused by a single thread, so that a search doesn't allocate
+    struct Scratch {
+        std::vector<Node> m_nodes;
+        std::vector<std::vector<Child>> m_children;
+        std::vector<uint64_t> m_fits;
+        std::vector<uint64_t> m_reach;
+        std::vector<int> m_work;
+        std::vector<Placement> m_places;
+        std::vector<std::pair<uint64_t, size_t>> m_order;
+        int m_rows[TETRIS_MATRIX_MAX_WIDTH + 1];
+        Board m_board;
+    };
+
+    struct Shard {
+        std::mutex m_mutex;
+        std::unordered_set<uint64_t> m_set;
+    };
+
+    std::vector<Shape> m_shapes[4];
+    std::vector<size_t> m_dims;
+    std::vector<int> m_queue;
+    Board m_start;
+    int m_startType = 0;
+    Placement m_startPlace{0, 0, 0};
+    int m_startHold = -1;
+    bool m_holdLocked = false;
+    int m_width;
+    int m_height;
+    uint64_t m_fullRow;
+
+    unsigned m_threads = 0;
+    size_t m_memoryLimit = TETRIS_SOLVER_DEFAULT_MEMORY;
+    std::chrono::milliseconds m_timeLimit{TETRIS_SOLVER_DEFAULT_TIME};
+
+    // Per search
+    int m_goalLines = 0;
+    bool m_perfect = false;
+    int m_heightLimit = 0;
+    int m_maxPieces = 0;
+    std::chrono::steady_clock::time_point m_deadline;
+    Shard m_shards[TETRIS_SOLVER_SHARDS];
+    std::atomic<size_t> m_memory{0};
+    std::atomic<size_t> m_visited{0};
+    std::atomic<bool> m_capped{false};
+    std::atomic<bool> m_timedOut{false};
+    std::atomic<size_t> m_bestTask{0};
+    std::mutex m_resultMutex;
+    std::vector<Step> m_solution;
+
+    void start();
+    SolverResult run();
+    bool search(int depth, std::vector<Step>& path, size_t task, Scratch& s);
+    bool expired();
+    bool goal(const Board& b, const State& st);
+    int knownPieces();
+    bool hopeless(const State& st, int depth);
+    int missing(const Board& b, const State& st);
+    void rowCounts(const Board& b, int* rows);
+    int fullest(const int* rows, int lines);
+    uint64_t hash(const Board& b, const State& st);
+    bool known(uint64_t h);
+    void remember(uint64_t h);
+    void expand(const Node& node, int depth, std::vector<Child>& out, Scratch& s);
+    void apply(const Node& parent, const Child& child, Node& out);
+    void prepare(Scratch& s);
+
+    bool check(const Board& b, int type, int x, int y, int rot);
+    bool spawn(const Board& b, int type, Placement& p);
+    int place(Board& b, int type, const Placement& p);
+    void landings(const Board& b, int type, const Placement& from, Scratch& s);
+    bool pathTo(const Board& b, int type, const Placement& from, const Placement& to, std::vector<TetrisAct>& acts);
+    bool fit(const Board& b, int type, int& x, int& y, int rot);
+    int visibleHeight(const Board& b);
+};
+
+#endif // TETRISSOLVER_H
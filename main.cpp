@@ -2,8 +2,29 @@
 
 using namespace std;
 
-int main() {
-    ConsoleDisplay display{};
+int main(int argc, char** argv) {
+    // ConsoleTetris [width height [uniform|bag|history [preview]]]
+    int width = TETRIS_MATRIX_WIDTH;
+    int height = TETRIS_MATRIX_HEIGHT;
+    auto random = TetrisRandom::uniform;
+    int preview = TETRIS_INCOMING_LOOK_AHEAD;
+    if(argc >= 3) {
+        width = atoi(argv[1]);
+        height = atoi(argv[2]);
+    }
+    if(argc >= 4) {
+        string name = argv[3];
+        if(name == "bag")
+            random = TetrisRandom::bag;
+        else if(name == "history")
+            random = TetrisRandom::history;
+    }
+    if(argc >= 5)
+        preview = atoi(argv[4]);
+    ConsoleDisplay display{width, height, random, preview};
+    auto home = getenv("HOME");
+    auto user = getenv("USER");
+    display.openRecords(string(home ? home : ".") + "/.ConsoleTetris", user ? user : "");
     auto prevTime = chrono::steady_clock::now();
     for(;;) {
         if(chrono::duration_cast<chrono::milliseconds>
@@ -1,5 +1,8 @@
 #include "ConsoleDisplay.h"
 
+#include <algorithm>
+#include <ctime>
+
 NCWindow::NCWindow() {}
 
 NCWindow::~NCWindow() {
@@ -54,7 +57,12 @@ void NCWindow::init(int height, int width, int starty, int startx) {
     refresh();
 }
 
-ConsoleDisplay::ConsoleDisplay() {
+ConsoleDisplay::ConsoleDisplay(int width, int height, TetrisRandom random, int preview) :
+    m_width(width),
+    m_height(height),
+    m_random(random),
+    m_preview(preview)
+{
     initscr();
 	raw();
 	keypad(stdscr, TRUE);
@@ -74,9 +82,14 @@ ConsoleDisplay::ConsoleDisplay() {
         addch(' ');
 	}
 	refresh();
+
+	m_width = m_sim.getWidth();
+	m_height = m_sim.getHeight();
+	m_viewWidth = std::max(1, std::min(m_width, COLS - 2 - 2*PANEL_WIDTH));
+	m_viewHeight = std::min(m_height, LINES - 2);
 	drawScores();
 
-	m_tetrisWindow.init(TETRIS_MATRIX_HEIGHT + 2, TETRIS_MATRIX_WIDTH + 2, Y1, X1);
+	m_tetrisWindow.init(m_viewHeight + 2, m_viewWidth + 2, Y1, X1);
 	drawIncoming();
 
     refresh();
@@ -87,6 +100,12 @@ ConsoleDisplay::~ConsoleDisplay() {
 	endwin();
 }
 
+void ConsoleDisplay::openRecords(const std::string& path, const std::string& player) {
+    m_player = player;
+    m_records.open(path);
+    drawScores();
+}
+
 void ConsoleDisplay::tick() {
     char key = getch();
     if(m_keyToAct.contains(key))
@@ -97,8 +116,12 @@ void ConsoleDisplay::tick() {
             while(getch() == -1);
             break;
         case 'q':
+            m_records.flush();
             exit(0);
             break;
+        case 'h':
+            requestHint();
+            break;
         default:
             break;
         }
@@ -107,8 +130,10 @@ void ConsoleDisplay::tick() {
     if(update & BV(TetrisUpdate::gameOver)) {
         m_tetrisWindow.mvprintw(1, 1, "GAME OVER!");
         m_tetrisWindow.refresh();
+        saveGame();
         while(getch() == -1) {}
         m_sim = TetrisSim(m_sim);
+        drawScores();
         mvprintw(Y1    , X1 - 4, "    ");
         mvprintw(Y1 + 1, X1 - 4, "    ");
         mvprintw(Y1 + 2, X1 - 4, "    ");
@@ -127,17 +152,34 @@ void ConsoleDisplay::tick() {
         drawScores();
     }
     if(update & BV(TetrisUpdate::newBlockTaken)) {
+        m_blockCount++;
         drawIncoming();
+        drawHint("");
     }
+    pollHint();
     if(update & BV(TetrisUpdate::needRedraw)) {
         redraw();
     }
 }
 
 void ConsoleDisplay::redraw() {
+    // Keep the falling block in sight on matrices larger than the screen
+    int margin = m_viewHeight/4;
+    int y = m_sim.getY();
+    if(y < m_viewTop + margin)
+        m_viewTop = std::max(0, y - margin);
+    else if(y + 4 > m_viewTop + m_viewHeight - margin)
+        m_viewTop = std::min(m_height - m_viewHeight, y + 4 - m_viewHeight + margin);
+    margin = m_viewWidth/4;
+    int x = m_sim.getX();
+    if(x < m_viewLeft + margin)
+        m_viewLeft = std::max(0, x - margin);
+    else if(x + 4 > m_viewLeft + m_viewWidth - margin)
+        m_viewLeft = std::min(m_width - m_viewWidth, x + 4 - m_viewWidth + margin);
+
     m_tetrisWindow.mvaddchar(1, 0, ' ');
-    for(int i = 0; i < TETRIS_MATRIX_HEIGHT; ++i) {
-        for(int j = 0; j < TETRIS_MATRIX_WIDTH; ++j) {
+    for(int i = m_viewTop; i < m_viewTop + m_viewHeight; ++i) {
+        for(int j = m_viewLeft; j < m_viewLeft + m_viewWidth; ++j) {
             auto ch = m_sim.cup(i,j);
             switch(ch) {
             case 0:
@@ -177,9 +219,12 @@ void ConsoleDisplay::drawIncoming() {
         mvaddstr(i, X2 + 1, "              ");
     }
 
+    // As much of the preview as fits on the screen
     int y = Y1;
-    for(int i = 0; i < TETRIS_INCOMING_LOOK_AHEAD; ++i) {
-        auto piece = m_sim.incoming(i);
+    for(int i = 0; i < m_sim.getPreview(); ++i) {
+        auto& piece = m_sim.incoming(i);
+        if(y + int(piece.m_dim) > LINES)
+            break;
         drawTetrimino(y, X2 + 1, piece);
         y += piece.m_dim + 1;
     }
@@ -187,13 +232,86 @@ void ConsoleDisplay::drawIncoming() {
 }
 
 void ConsoleDisplay::drawScores() {
-    mvprintw(Y1,     0, "Score: %i", m_sim.getScore());
-    mvprintw(Y1 + 1, 0, "Cleared Lines: %i", m_sim.getFinishedLines());
-    mvprintw(Y1 + 2, 0, "Level: %i", m_sim.getLevel());
+    char text[64];
+    snprintf(text, sizeof(text), "Score: %i", m_sim.getScore());
+    drawStat(0, text);
+    snprintf(text, sizeof(text), "Cleared Lines: %i", m_sim.getFinishedLines());
+    drawStat(1, text);
+    snprintf(text, sizeof(text), "Level: %i", m_sim.getLevel());
+    drawStat(2, text);
     auto combo = m_sim.getCombo();
     if(combo != 0)
-        mvprintw(Y1 + 3, 0, "Combo: %i", combo);
+        snprintf(text, sizeof(text), "Combo: %i", combo);
     else
-        mvprintw(Y1 + 3, 0, "           ");
+        text[0] = '\0';
+    drawStat(3, text);
+    if(m_records.isOpen()) {
+        auto best = m_records.top(1);
+        if(!best.empty()) {
+            snprintf(text, sizeof(text), "Best: %i (%s)", best[0].m_score, best[0].getPlayer().c_str());
+            drawStat(4, text);
+        }
+    }
+    refresh();
+}
+
+void ConsoleDisplay::requestHint() {
+    if(m_hint.valid()) {
+        m_hintAgain = true;
+        return;
+    }
+    // The solver takes a copy of the matrix, so the game goes on while it searches
+    auto solver = std::make_shared<TetrisSolver>(m_sim);
+    m_hint = std::async(std::launch::async, [solver]() { return solver->perfectClear(); });
+    m_hintBlock = m_blockCount;
+    drawHint("Searching...");
+}
+
+void ConsoleDisplay::pollHint() {
+    if(!m_hint.valid() || m_hint.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        return;
+    auto res = m_hint.get();
+    if(m_hintBlock != m_blockCount) {
+        // The block was placed meanwhile, the answer is about the old one
+        if(m_hintAgain) {
+            m_hintAgain = false;
+            requestHint();
+        }
+        return;
+    }
+    m_hintAgain = false;
+
+    char text[32];
+    if(res.m_found) {
+        snprintf(text, sizeof(text), "PC in %i pieces", int(res.m_moves.size()));
+        drawHint(text);
+    }
+    else {
+        drawHint(res.m_timedOut ? "No PC found in time" : "No PC ahead");
+    }
+}
+
+void ConsoleDisplay::drawHint(const char* text) {
+    drawStat(5, text);
     refresh();
 }
+
+void ConsoleDisplay::drawStat(int line, const char* text) {
+    // Cut to the space left of the held block
+    int width = std::max(0, X1 - 5);
+    mvprintw(Y1 + line, 0, "%-*.*s", width, width, text);
+}
+
+void ConsoleDisplay::saveGame() {
+    GameRecord record;
+    record.m_score = m_sim.getScore();
+    record.m_lines = m_sim.getFinishedLines();
+    record.m_level = m_sim.getLevel();
+    record.m_maxCombo = m_sim.getMaxCombo();
+    record.m_duration = m_sim.getDuration();
+    record.m_seed = m_sim.getSeed();
+    record.m_random = uint32_t(m_sim.getRandom());
+    record.m_time = std::time(nullptr);
+    record.setPlayer(m_player);
+    m_records.add(record);
+}
@@ -0,0 +1,123 @@
+#include "TetrisRandomizer.h"
+
+#include <algorithm>
+
+TetrisRandomizer::TetrisRandomizer(int pieces, uint64_t seed) :
+    m_pieces(pieces),
+    m_seed(seed) {}
+
+std::shared_ptr<const TetrisRandomizer> TetrisRandomizer::create(TetrisRandom kind, int pieces, uint64_t seed) {
+    switch(kind) {
+    case TetrisRandom::bag:
+        return std::make_shared<BagRandomizer>(pieces, seed);
+    case TetrisRandom::history:
+        return std::make_shared<HistoryRandomizer>(pieces, seed);
+    case TetrisRandom::uniform:
+    default:
+        return std::make_shared<UniformRandomizer>(pieces, seed);
+    }
+}
+
+uint64_t TetrisRandomizer::draw(uint64_t index, uint64_t stream) const {
+    // splitmix64 of the position in the stream
+    uint64_t z = m_seed + stream * 0xD1B54A32D192ED03ull + (index + 1) * 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+int TetrisRandomizer::range(uint64_t value, int n) {
+    return int(((value >> 32) * uint64_t(n)) >> 32);
+}
+
+size_t UniformRandomizer::blockSize() const {
+    return TETRIS_RANDOMIZER_BLOCK;
+}
+
+void UniformRandomizer::generate(uint64_t block, int* out) const {
+    uint64_t first = block * TETRIS_RANDOMIZER_BLOCK;
+    for(size_t i = 0; i < TETRIS_RANDOMIZER_BLOCK; ++i)
+        out[i] = range(draw(first + i), m_pieces);
+}
+
+size_t BagRandomizer::blockSize() const {
+    return m_pieces;
+}
+
+void BagRandomizer::generate(uint64_t block, int* out) const {
+    uint64_t first = block * m_pieces;
+    for(int i = 0; i < m_pieces; ++i)
+        out[i] = i;
+    for(int i = m_pieces - 1; i > 0; --i)
+        std::swap(out[i], out[range(draw(first + i), i + 1)]);
+}
+
+size_t HistoryRandomizer::blockSize() const {
+    return TETRIS_RANDOMIZER_BLOCK;
+}
+
+void HistoryRandomizer::generate(uint64_t block, int* out) const {
+    int history[TETRIS_HISTORY_SIZE];
+    for(int i = 0; i < TETRIS_HISTORY_SIZE; ++i)
+        history[i] = range(draw(block * TETRIS_HISTORY_SIZE + i, 1), m_pieces);
+
+    uint64_t first = block * TETRIS_RANDOMIZER_BLOCK;
+    for(size_t i = 0; i < TETRIS_RANDOMIZER_BLOCK; ++i) {
+        int piece = 0;
+        for(int t = 0; t < TETRIS_HISTORY_TRIES; ++t) {
+            piece = range(draw((first + i) * TETRIS_HISTORY_TRIES + t), m_pieces);
+            if(std::find(history, history + TETRIS_HISTORY_SIZE, piece) == history + TETRIS_HISTORY_SIZE)
+                break;
+        }
+        std::move(history + 1, history + TETRIS_HISTORY_SIZE, history);
+        history[TETRIS_HISTORY_SIZE - 1] = piece;
+        out[i] = piece;
+    }
+}
+
+TetrisPieceQueue::TetrisPieceQueue(std::shared_ptr<const TetrisRandomizer> rand, size_t depth) :
+    m_rand(rand),
+    m_block(rand->blockSize()),
+    m_depth(std::max<size_t>(depth, 1))
+{
+    // Room for the preview and one more block that doesn't fit into it
+    size_t size = 1;
+    while(size < m_depth + m_block.size())
+        size *= 2;
+    m_ring.resize(size);
+    m_mask = size - 1;
+    fill();
+}
+
+int TetrisPieceQueue::next() {
+    int piece = m_ring[m_head & m_mask];
+    m_head++;
+    fill();
+    return piece;
+}
+
+int TetrisPieceQueue::peek(size_t n) {
+    return m_ring[(m_head + n) & m_mask];
+}
+
+void TetrisPieceQueue::seek(uint64_t index) {
+    m_head = index;
+    m_end = index - index % m_block.size();
+    fill();
+}
+
+uint64_t TetrisPieceQueue::position() {
+    return m_head;
+}
+
+size_t TetrisPieceQueue::depth() {
+    return m_depth;
+}
+
+void TetrisPieceQueue::fill() {
+    while(m_end < m_head + m_depth) {
+        m_rand->generate(m_end / m_block.size(), m_block.data());
+        for(int piece : m_block)
+            m_ring[m_end++ & m_mask] = piece;
+    }
+}
@@ -0,0 +1,426 @@
+#include "TetrisRecords.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static_assert(sizeof(GameRecord) == 64, "GameRecord is stored as is");
+
+static uint64_t fnv(const void* data, size_t size) {
+    auto bytes = static_cast<const uint8_t*>(data);
+    uint64_t h = 0xCBF29CE484222325ull;
+    for(size_t i = 0; i < size; ++i) {
+        h ^= bytes[i];
+        h *= 0x100000001B3ull;
+    }
+    return h;
+}
+
+// msync() wants page aligned addresses
+static void syncRange(char* base, size_t from, size_t to) {
+    static const size_t PAGE = sysconf(_SC_PAGESIZE);
+    from -= from % PAGE;
+    msync(base + from, to - from, MS_SYNC);
+}
+
+void GameRecord::setPlayer(const std::string& name) {
+    std::memset(m_player, 0, sizeof(m_player));
+    // Empty slots of the index are told apart by an empty name
+    std::string use = name.empty() ? "anonymous" : name;
+    std::memcpy(m_player, use.data(), std::min(use.size(), sizeof(m_player) - 1));
+}
+
+std::string GameRecord::getPlayer() const {
+    return std::string(m_player, strnlen(m_player, sizeof(m_player)));
+}
+
+TetrisRecords::TetrisRecords() {}
+
+TetrisRecords::~TetrisRecords() {
+    close();
+}
+
+bool TetrisRecords::open(const std::string& path) {
+    close();
+
+    m_dataFd = ::open((path + ".dat").c_str(), O_RDWR | O_CREAT, 0644);
+    m_indexFd = ::open((path + ".idx").c_str(), O_RDWR | O_CREAT, 0644);
+    struct stat st;
+    // Every instance keeps its own count, only one may write at a time.
+    // The lock goes away with the descriptor.
+    if(m_dataFd < 0 || m_indexFd < 0 || flock(m_dataFd, LOCK_EX | LOCK_NB) != 0 ||
+       fstat(m_dataFd, &st) != 0) {
+        close();
+        return false;
+    }
+
+    if(size_t(st.st_size) < sizeof(DataHeader)) {
+        if(!mapData(TETRIS_RECORDS_INITIAL)) {
+            close();
+            return false;
+        }
+        *dataHeader() = DataHeader{TETRIS_RECORDS_MAGIC, TETRIS_RECORDS_VERSION, sizeof(GameRecord), 0, {}};
+        syncRange(m_data, 0, sizeof(DataHeader));
+    }
+    else if(!mapData((st.st_size - sizeof(DataHeader)) / sizeof(GameRecord))) {
+        close();
+        return false;
+    }
+
+    auto header = dataHeader();
+    uint32_t version = header->m_version;
+    if(header->m_magic != TETRIS_RECORDS_MAGIC || version < 1 || version > TETRIS_RECORDS_VERSION ||
+       header->m_recordSize != sizeof(GameRecord) ||
+       sizeof(DataHeader) + header->m_count * sizeof(GameRecord) > m_dataSize) {
+        close();
+        return false;
+    }
+    // Anything written after the last committed count is dropped
+    m_count = header->m_count;
+    // An upgrade that didn't finish leaves records of both versions
+    auto intact = [&](const GameRecord& r) {
+        return r.m_check == checksum(r) || r.m_check == checksum(r, version);
+    };
+    while(m_count > 0 && !intact(*record(m_count - 1)))
+        m_count--;
+    if(version != TETRIS_RECORDS_VERSION) {
+        for(uint64_t i = 0; i < m_count; ++i)
+            record(i)->m_check = checksum(*record(i));
+        syncRange(m_data, 0, sizeof(DataHeader) + m_count * sizeof(GameRecord));
+        header->m_version = TETRIS_RECORDS_VERSION;
+        syncRange(m_data, 0, sizeof(DataHeader));
+    }
+
+    bool valid = false;
+    if(fstat(m_indexFd, &st) == 0 && size_t(st.st_size) >= sizeof(IndexHeader)) {
+        IndexHeader stored;
+        if(pread(m_indexFd, &stored, sizeof(stored), 0) == sizeof(stored) &&
+           stored.m_magic == TETRIS_RECORDS_MAGIC && stored.m_version == TETRIS_RECORDS_VERSION &&
+           !stored.m_dirty && stored.m_covered <= m_count && stored.m_top <= TETRIS_RECORDS_TOP &&
+           stored.m_playerCapacity && !(stored.m_playerCapacity & (stored.m_playerCapacity - 1)) &&
+           size_t(st.st_size) == sizeof(IndexHeader) + TETRIS_RECORDS_TOP * sizeof(TopEntry) +
+                                 stored.m_playerCapacity * sizeof(PlayerSlot))
+            valid = mapIndex(stored.m_playerCapacity) && indexSane();
+    }
+    if(!valid) {
+        rebuildIndex();
+    }
+    else if(indexHeader()->m_covered < m_count) {
+        // Games committed after the index was last written
+        markDirty();
+        for(uint64_t i = indexHeader()->m_covered; i < m_count; ++i)
+            indexRecord(i);
+        indexHeader()->m_covered = m_count;
+        syncRange(m_index, 0, m_indexSize);
+        indexHeader()->m_dirty = 0;
+    }
+    if(m_index == nullptr) {
+        close();
+        return false;
+    }
+
+    m_stop = false;
+    m_writer = std::thread(&TetrisRecords::writerLoop, this);
+    return true;
+}
+
+void TetrisRecords::close() {
+    if(m_writer.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(m_queueMutex);
+            m_stop = true;
+        }
+        m_queueCond.notify_all();
+        m_writer.join();
+    }
+    if(m_data != nullptr)
+        munmap(m_data, m_dataSize);
+    if(m_index != nullptr)
+        munmap(m_index, m_indexSize);
+    if(m_dataFd >= 0)
+        ::close(m_dataFd);
+    if(m_indexFd >= 0)
+        ::close(m_indexFd);
+    m_data = m_index = nullptr;
+    m_dataSize = m_indexSize = 0;
+    m_dataFd = m_indexFd = -1;
+    m_count = 0;
+}
+
+bool TetrisRecords::isOpen() {
+    return m_data != nullptr;
+}
+
+void TetrisRecords::add(const GameRecord& record) {
+    if(!isOpen())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        m_queue.push_back(record);
+    }
+    m_queueCond.notify_one();
+}
+
+void TetrisRecords::flush() {
+    std::unique_lock<std::mutex> lock(m_queueMutex);
+    m_doneCond.wait(lock, [this]() { return m_queue.empty() && !m_writing; });
+}
+
+size_t TetrisRecords::size() {
+    std::shared_lock<std::shared_mutex> lock(m_mapMutex);
+    return m_count;
+}
+
+std::vector<GameRecord> TetrisRecords::top(size_t n) {
+    std::vector<GameRecord> out;
+    std::shared_lock<std::shared_mutex> lock(m_mapMutex);
+    if(!isOpen())
+        return out;
+    n = std::min<size_t>(n, indexHeader()->m_top);
+    for(size_t i = 0; i < n; ++i)
+        out.push_back(*record(topEntries()[i].m_record));
+    return out;
+}
+
+std::vector<GameRecord> TetrisRecords::history(const std::string& player, size_t n) {
+    std::vector<GameRecord> out;
+    GameRecord key;
+    key.setPlayer(player);
+    std::shared_lock<std::shared_mutex> lock(m_mapMutex);
+    if(!isOpen())
+        return out;
+    auto slot = findPlayer(key.m_player, false);
+    for(int64_t i = slot ? slot->m_last : -1; i >= 0 && out.size() < n; i = record(i)->m_prevByPlayer)
+        out.push_back(*record(i));
+    return out;
+}
+
+TetrisRecords::DataHeader* TetrisRecords::dataHeader() {
+    return reinterpret_cast<DataHeader*>(m_data);
+}
+
+GameRecord* TetrisRecords::record(uint64_t i) {
+    return reinterpret_cast<GameRecord*>(m_data + sizeof(DataHeader)) + i;
+}
+
+TetrisRecords::IndexHeader* TetrisRecords::indexHeader() {
+    return reinterpret_cast<IndexHeader*>(m_index);
+}
+
+TetrisRecords::TopEntry* TetrisRecords::topEntries() {
+    return reinterpret_cast<TopEntry*>(m_index + sizeof(IndexHeader));
+}
+
+TetrisRecords::PlayerSlot* TetrisRecords::playerSlots() {
+    return reinterpret_cast<PlayerSlot*>(topEntries() + TETRIS_RECORDS_TOP);
+}
+
+void TetrisRecords::writerLoop() {
+    std::deque<GameRecord> batch;
+    std::unique_lock<std::mutex> lock(m_queueMutex);
+    for(;;) {
+        m_queueCond.wait(lock, [this]() { return m_stop || !m_queue.empty(); });
+        if(m_queue.empty())
+            break;
+        // Everything that piled up meanwhile is committed with a single sync
+        batch.clear();
+        batch.swap(m_queue);
+        m_writing = true;
+        lock.unlock();
+        write(batch);
+        lock.lock();
+        m_writing = false;
+        m_doneCond.notify_all();
+    }
+    m_doneCond.notify_all();
+}
+
+void TetrisRecords::write(std::deque<GameRecord>& batch) {
+    uint64_t first = m_count;
+    markDirty();
+    {
+        std::unique_lock<std::shared_mutex> lock(m_mapMutex);
+        size_t capacity = (m_dataSize - sizeof(DataHeader)) / sizeof(GameRecord);
+        size_t needed = std::max<size_t>(capacity, TETRIS_RECORDS_INITIAL);
+        while(m_count + batch.size() > needed)
+            needed *= 2;
+        if(needed != capacity && !mapData(needed))
+            return;
+
+        for(auto& r : batch) {
+            r.m_prevByPlayer = findPlayer(r.m_player, true)->m_last;
+            r.m_check = checksum(r);
+            *record(m_count) = r;
+            indexRecord(m_count);
+            m_count++;
+        }
+    }
+
+    // Records reach the disk before the count that makes them visible,
+    // the index is only marked clean once it matches a committed count.
+    // Only this thread remaps, so the maps stay in place without the lock.
+    syncRange(m_data, sizeof(DataHeader) + first * sizeof(GameRecord),
+              sizeof(DataHeader) + m_count * sizeof(GameRecord));
+    dataHeader()->m_count = m_count;
+    syncRange(m_data, 0, sizeof(DataHeader));
+    syncRange(m_index, 0, m_indexSize);
+
+    std::unique_lock<std::shared_mutex> lock(m_mapMutex);
+    indexHeader()->m_covered = m_count;
+    indexHeader()->m_dirty = 0;
+}
+
+bool TetrisRecords::mapData(size_t capacity) {
+    size_t size = sizeof(DataHeader) + capacity * sizeof(GameRecord);
+    if(m_data != nullptr)
+        munmap(m_data, m_dataSize);
+    m_data = nullptr;
+    if(ftruncate(m_dataFd, size) != 0)
+        return false;
+    void* map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_dataFd, 0);
+    if(map == MAP_FAILED)
+        return false;
+    m_data = static_cast<char*>(map);
+    m_dataSize = size;
+    return true;
+}
+
+bool TetrisRecords::mapIndex(size_t playerCapacity) {
+    size_t size = sizeof(IndexHeader) + TETRIS_RECORDS_TOP * sizeof(TopEntry) +
+                  playerCapacity * sizeof(PlayerSlot);
+    if(m_index != nullptr)
+        munmap(m_index, m_indexSize);
+    m_index = nullptr;
+    if(ftruncate(m_indexFd, size) != 0)
+        return false;
+    void* map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_indexFd, 0);
+    if(map == MAP_FAILED)
+        return false;
+    m_index = static_cast<char*>(map);
+    m_indexSize = size;
+    return true;
+}
+
+void TetrisRecords::rebuildIndex() {
+    if(m_index != nullptr)
+        munmap(m_index, m_indexSize);
+    m_index = nullptr;
+    // Truncating first zeroes everything
+    if(ftruncate(m_indexFd, 0) != 0 || !mapIndex(TETRIS_RECORDS_INITIAL_PLAYERS))
+        return;
+
+    auto index = indexHeader();
+    *index = IndexHeader{TETRIS_RECORDS_MAGIC, TETRIS_RECORDS_VERSION, 1, 0, 0,
+                         TETRIS_RECORDS_INITIAL_PLAYERS, 0, {}};
+    for(uint64_t i = 0; i < m_count; ++i)
+        indexRecord(i);
+    indexHeader()->m_covered = m_count;
+    syncRange(m_index, 0, m_indexSize);
+    indexHeader()->m_dirty = 0;
+}
+
+// The header has to be dirty on disk before any other page of the index
+// changes, the kernel writes pages back in no particular order
+void TetrisRecords::markDirty() {
+    indexHeader()->m_dirty = 1;
+    syncRange(m_index, 0, sizeof(IndexHeader));
+}
+
+// Nothing in a clean index may point at games it doesn't cover
+bool TetrisRecords::indexSane() {
+    auto index = indexHeader();
+    if(index->m_players > index->m_playerCapacity)
+        return false;
+    for(uint64_t i = 0; i < index->m_top; ++i) {
+        if(topEntries()[i].m_record < 0 || uint64_t(topEntries()[i].m_record) >= index->m_covered)
+            return false;
+    }
+    for(uint64_t i = 0; i < index->m_playerCapacity; ++i) {
+        auto& slot = playerSlots()[i];
+        if(slot.m_name[0] != 0 && (slot.m_last < -1 || slot.m_last >= int64_t(index->m_covered)))
+            return false;
+    }
+    return true;
+}
+
+void TetrisRecords::indexRecord(uint64_t i) {
+    auto& r = *record(i);
+    auto slot = findPlayer(r.m_player, true);
+    slot->m_last = i;
+    slot->m_games++;
+    slot->m_best = slot->m_games == 1 ? r.m_score : std::max(slot->m_best, r.m_score);
+
+    // Leaderboard, equal scores keep the older game first
+    auto index = indexHeader();
+    auto entries = topEntries();
+    auto end = entries + index->m_top;
+    if(index->m_top == TETRIS_RECORDS_TOP && r.m_score <= end[-1].m_score)
+        return;
+    auto pos = std::upper_bound(entries, end, int64_t(r.m_score),
+                                [](int64_t score, const TopEntry& e) { return score > e.m_score; });
+    if(index->m_top == TETRIS_RECORDS_TOP)
+        end--;
+    else
+        index->m_top++;
+    std::memmove(pos + 1, pos, (end - pos) * sizeof(TopEntry));
+    *pos = TopEntry{r.m_score, int64_t(i)};
+}
+
+TetrisRecords::PlayerSlot* TetrisRecords::findPlayer(const char* name, bool create) {
+    if(create && (indexHeader()->m_players + 1) * 2 > indexHeader()->m_playerCapacity)
+        growPlayers();
+
+    auto mask = indexHeader()->m_playerCapacity - 1;
+    auto slots = playerSlots();
+    for(auto i = hashName(name) & mask;; i = (i + 1) & mask) {
+        if(slots[i].m_name[0] == 0) {
+            if(!create)
+                return nullptr;
+            std::memcpy(slots[i].m_name, name, TETRIS_RECORDS_NAME);
+            slots[i].m_last = -1;
+            indexHeader()->m_players++;
+            return &slots[i];
+        }
+        if(std::memcmp(slots[i].m_name, name, TETRIS_RECORDS_NAME) == 0)
+            return &slots[i];
+    }
+}
+
+void TetrisRecords::growPlayers() {
+    std::vector<PlayerSlot> players;
+    auto capacity = indexHeader()->m_playerCapacity;
+    for(size_t i = 0; i < capacity; ++i) {
+        if(playerSlots()[i].m_name[0] != 0)
+            players.push_back(playerSlots()[i]);
+    }
+
+    if(!mapIndex(capacity * 2))
+        return;
+    indexHeader()->m_playerCapacity = capacity * 2;
+    std::memset(playerSlots(), 0, capacity * 2 * sizeof(PlayerSlot));
+
+    auto mask = capacity * 2 - 1;
+    for(auto& p : players) {
+        auto i = hashName(p.m_name) & mask;
+        while(playerSlots()[i].m_name[0] != 0)
+            i = (i + 1) & mask;
+        playerSlots()[i] = p;
+    }
+}
+
+uint32_t TetrisRecords::checksum(const GameRecord& record, uint32_t version) {
+    if(version == 1)
+        return fnv(&record, offsetof(GameRecord, m_check));
+    GameRecord copy = record;
+    copy.m_check = 0;
+    return fnv(&copy, sizeof(copy));
+}
+
+uint64_t TetrisRecords::hashName(const char* name) {
+    return fnv(name, TETRIS_RECORDS_NAME);
+}
@@ -1,5 +1,12 @@
 #include "TetrisSim.h"
 
+#include <algorithm>
+#include <bit>
+
+static uint64_t shiftMask(uint64_t mask, int x) {
+    return x >= 0 ? mask << x : mask >> -x;
+}
+
 Tetrimino::Tetrimino(std::vector<std::vector<bool>>&& shape, unsigned char color = 1) :
     m_color(color)
 {
@@ -18,6 +25,16 @@ Tetrimino::Tetrimino(std::vector<std::vector<bool>>&& shape, unsigned char color
         }
     }
 
+    for(int k = 0; k < 4; ++k) {
+        m_mask[k].resize(m_dim, 0);
+        for(size_t i = 0; i < m_dim; ++i) {
+            for(size_t j = 0; j < m_dim; ++j) {
+                if(m_shape[k][i][j])
+                    m_mask[k][i] |= 1ull << j;
+            }
+        }
+    }
+
 //    for(int k = 0; k < 4; ++k) {
 //        for(int i = 0; i < m_dim; ++i) {
 //            for(int j = 0; j < m_dim; ++j) {
@@ -29,20 +46,23 @@ Tetrimino::Tetrimino(std::vector<std::vector<bool>>&& shape, unsigned char color
 //    }
 }
 
-TetrisSim::TetrisSim(std::vector<Tetrimino>&& blocks) :
-    m_blocks(blocks)
+TetrisSim::TetrisSim(std::vector<Tetrimino>&& blocks, int width, int height, TetrisRandom random, int preview) :
+    m_width(std::clamp(width, 4, TETRIS_MATRIX_MAX_WIDTH)),
+    m_height(std::clamp(height, 4, TETRIS_MATRIX_MAX_HEIGHT)),
+    m_fullRow(m_width == 64 ? ~0ull : (1ull << m_width) - 1),
+    m_cup(m_height + 4, std::vector<uint8_t>(m_width, 0)),
+    m_rows(m_height + 4, 0),
+    m_blocks(blocks),
+    m_random(random),
+    m_seed(std::random_device{}()),
+    m_queue(TetrisRandomizer::create(random, m_blocks.size(), m_seed), std::clamp(preview, 1, TETRIS_PREVIEW_MAX))
 {
-    std::random_device seed;
-    m_rand.seed(seed());
-    for(int i = 0; i < TETRIS_INCOMING_LOOK_AHEAD; ++i) {
-        m_incoming[i] = m_rand() % m_blocks.size();
-    }
     newBlock();
     updateGhost();
 }
 
 TetrisSim::TetrisSim(TetrisSim& in) :
-    TetrisSim(std::move(in.m_blocks)) {}
+    TetrisSim(std::move(in.m_blocks), in.m_width, in.m_height, in.m_random, in.m_queue.depth()) {}
 
 bool TetrisSim::act(TetrisAct a) {
     if(m_state >= BV(TetrisState::noActAfter))
@@ -109,7 +129,11 @@ uint8_t TetrisSim::getColor() {
 }
 
 Tetrimino& TetrisSim::incoming(int N) {
-    return m_blocks[m_incoming[(m_incomingN + N) % TETRIS_INCOMING_LOOK_AHEAD]];
+    return m_blocks[m_queue.peek(N)];
+}
+
+int TetrisSim::getPreview() {
+    return m_queue.depth();
 }
 
 uint64_t TetrisSim::tick() {
@@ -133,19 +157,30 @@ uint64_t TetrisSim::tick() {
     }
     if(m_state & BV(TetrisState::lineClearing)) {
         if(m_finishProgress > 0) {
+            // Wide matrices take as long to clear as the standard one
+            int step = std::min(m_finishProgress, (m_width + TETRIS_MATRIX_WIDTH - 1)/TETRIS_MATRIX_WIDTH);
             for(int i = 0; i < m_finishNum; ++i) {
-                m_cup[4 + m_finishLines[i]][m_finishProgress - 1] = 0;
+                for(int j = m_finishProgress - step; j < m_finishProgress; ++j) {
+                    m_cup[4 + m_finishLines[i]][j] = 0;
+                    m_rows[4 + m_finishLines[i]] &= ~(1ull << j);
+                }
             }
-            m_finishProgress--;
+            m_finishProgress -= step;
         }
         else {
             for(int i = 0; i < m_finishNum; ++i) {
-                m_cup.erase(m_cup.begin() + 4 + m_finishLines[i]);
-                m_cup.insert(m_cup.begin(), std::vector<uint8_t>(TETRIS_MATRIX_WIDTH, 0));
+                // Shift the rows above down, reusing the cleared one as the new top
+                auto row = m_cup.begin() + 4 + m_finishLines[i];
+                std::rotate(m_cup.begin(), row, row + 1);
+                auto mask = m_rows.begin() + 4 + m_finishLines[i];
+                std::rotate(m_rows.begin(), mask, mask + 1);
+                std::fill(m_cup[0].begin(), m_cup[0].end(), 0);
+                m_rows[0] = 0;
             }
 
             m_finishedLines += m_finishNum;
             m_combo += m_finishNum;
+            m_maxCombo = std::max(m_maxCombo, m_combo);
             m_score += m_combo * (m_level + 1);
             if(m_level < MAX_LEVEL)
                 m_level += std::min(MAX_LEVEL, m_score/(10 * m_level));
@@ -163,18 +198,16 @@ uint64_t TetrisSim::tick() {
 }
 
 bool TetrisSim::check(uint8_t type, int x, int y, uint8_t rot) {
-    auto siz = m_blocks[type].m_dim;
-    for(uint8_t i = 0; i < siz; ++i) {
-        for(uint8_t j = 0; j < siz; ++j) {
-            if(m_blocks[type].m_shape[rot][i][j]) {
-                if(y + i >= TETRIS_MATRIX_HEIGHT ||
-                   x + j >= TETRIS_MATRIX_WIDTH ||
-                   x + j < 0 ||
-                   y + i < -2)
-                    return false;
-                if(m_cup[4 + y + i][x + j])
-                    return false;
-            }
+    auto& mask = m_blocks[type].m_mask[rot];
+    for(int i = 0; i < int(mask.size()); ++i) {
+        if(mask[i]) {
+            if(y + i >= m_height ||
+               x + int(std::bit_width(mask[i])) > m_width ||
+               x + std::countr_zero(mask[i]) < 0 ||
+               y + i < -2)
+                return false;
+            if(m_rows[4 + y + i] & shiftMask(mask[i], x))
+                return false;
         }
     }
     return true;
@@ -209,7 +242,7 @@ bool TetrisSim::tryPutting(uint8_t type, int x, int y, uint8_t rot, bool fit) {
 }
 
 void TetrisSim::updateGhost() {
-    for(int i = m_tY + 1; i < TETRIS_MATRIX_HEIGHT; ++i) {
+    for(int i = m_tY + 1; i < m_height; ++i) {
         if(!check(m_tType, m_tX, i, m_tRot)) {
             m_ghostY = i - 1;
             return;
@@ -226,18 +259,19 @@ void TetrisSim::finalize() {
             if(m_blocks[m_tType].m_shape[m_tRot][i][j])
                 m_cup[4 + m_tY + i][m_tX + j] = m_blocks[m_tType].m_color;
         }
+        if(m_blocks[m_tType].m_mask[m_tRot][i])
+            m_rows[4 + m_tY + i] |= shiftMask(m_blocks[m_tType].m_mask[m_tRot][i], m_tX);
     }
 
-    for(int i = 0; i < TETRIS_MATRIX_HEIGHT; ++i) {
-        int j = 0;
-        for(; j < TETRIS_MATRIX_WIDTH && m_cup[4 + i][j]; ++j) {}
-        if(j >= TETRIS_MATRIX_WIDTH)
+    // Only the rows the block landed on could have been completed
+    for(int i = std::max(0, m_tY); i < std::min(m_height, m_tY + int(siz)); ++i) {
+        if(m_rows[4 + i] == m_fullRow)
             m_finishLines[m_finishNum++] = i;
     }
     if(m_finishNum) {
         m_state |= BV(TetrisState::lineClearing);
         m_update |= BV(TetrisUpdate::scoreChange);
-        m_finishProgress = TETRIS_MATRIX_WIDTH;
+        m_finishProgress = m_width;
     }
     else {
         m_combo = 0;
@@ -253,16 +287,14 @@ void TetrisSim::newBlock(int type) {
     m_update |= BV(TetrisUpdate::needRedraw);
 
     if(type == -1) {
-        m_tType = m_incoming[m_incomingN];
-        m_incoming[m_incomingN] = m_rand() % m_blocks.size();
-        m_incomingN = (m_incomingN + 1) % TETRIS_INCOMING_LOOK_AHEAD;
+        m_tType = m_queue.next();
     }
     else {
         m_tType = type;
     }
 
     m_tY = -m_blocks[m_tType].m_dim / 2;
-    m_tX = (TETRIS_MATRIX_WIDTH - m_blocks[m_tType].m_dim)/2;
+    m_tX = (m_width - m_blocks[m_tType].m_dim)/2;
     m_tRot = 0;
 
     if(!check(m_tType, m_tX, m_tY, m_tRot))
@@ -288,3 +320,40 @@ int TetrisSim::getLevel() {
 int TetrisSim::getScore() {
     return m_score;
 }
+
+int TetrisSim::getMaxCombo() {
+    return m_maxCombo;
+}
+
+uint32_t TetrisSim::getSeed() {
+    return m_seed;
+}
+
+TetrisRandom TetrisSim::getRandom() {
+    return m_random;
+}
+
+uint64_t TetrisSim::getPieceIndex() {
+    return m_queue.position() - 1;
+}
+
+uint32_t TetrisSim::getDuration() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - m_startTime).count();
+}
+
+int TetrisSim::getWidth() {
+    return m_width;
+}
+
+int TetrisSim::getHeight() {
+    return m_height;
+}
+
+int TetrisSim::getX() {
+    return m_tX;
+}
+
+int TetrisSim::getY() {
+    return m_tY;
+}
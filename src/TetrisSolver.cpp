@@ -0,0 +1,682 @@
+#include "TetrisSolver.h"
+
+#include <algorithm>
+#include <bit>
+#include <thread>
+
+static const int FIT_ORDER[] = {0, -1, 1};
+
+static uint64_t mix(uint64_t h, uint64_t v) {
+    h ^= v + 0x9E3779B97F4A7C15ull + (h << 6) + (h >> 2);
+    h ^= h >> 31;
+    h *= 0xBF58476D1CE4E5B9ull;
+    return h ^ (h >> 29);
+}
+
+static uint64_t shifted(uint64_t mask, int x) {
+    return x >= 0 ? mask << x : mask >> -x;
+}
+
+TetrisSolver::TetrisSolver(TetrisSim& sim) :
+    m_width(sim.m_width),
+    m_height(sim.m_height),
+    m_fullRow(sim.m_fullRow)
+{
+
+    for(auto& block : sim.m_blocks) {
+        m_dims.push_back(block.m_dim);
+        for(int rot = 0; rot < 4; ++rot) {
+            Shape s;
+            s.m_dim = block.m_dim;
+            s.m_minCol = s.m_minRow = s.m_dim;
+            s.m_maxCol = s.m_maxRow = -1;
+            for(int i = 0; i < s.m_dim; ++i) {
+                for(int j = 0; j < s.m_dim; ++j) {
+                    if(block.m_shape[rot][i][j]) {
+                        s.m_rows[i] |= 1ull << j;
+                        s.m_minCol = std::min(s.m_minCol, j);
+                        s.m_maxCol = std::max(s.m_maxCol, j);
+                        s.m_minRow = std::min(s.m_minRow, i);
+                        s.m_maxRow = std::max(s.m_maxRow, i);
+                    }
+                }
+            }
+            m_shapes[rot].push_back(s);
+        }
+    }
+
+    m_start.m_rows = sim.m_rows;
+    // Lines that are still being animated are already gone for the player
+    if(sim.m_state & BV(TetrisState::lineClearing)) {
+        for(int i = 0; i < sim.m_finishNum; ++i) {
+            m_start.m_rows.erase(m_start.m_rows.begin() + 4 + sim.m_finishLines[i]);
+            m_start.m_rows.insert(m_start.m_rows.begin(), 0);
+        }
+    }
+    for(auto row : m_start.m_rows)
+        m_start.m_cells += std::popcount(row);
+
+    for(size_t i = 0; i < sim.m_queue.depth(); ++i)
+        m_queue.push_back(sim.m_queue.peek(i));
+    m_startType = sim.m_tType;
+    m_startPlace = {sim.m_tX, sim.m_tY, sim.m_tRot};
+    m_startHold = sim.m_hold;
+    m_holdLocked = sim.m_state & BV(TetrisState::swapped);
+
+    m_threads = std::max(1u, std::thread::hardware_concurrency());
+}
+
+void TetrisSolver::setThreads(unsigned threads) {
+    m_threads = std::max(1u, threads);
+}
+
+void TetrisSolver::setMemoryLimit(size_t bytes) {
+    m_memoryLimit = bytes;
+}
+
+void TetrisSolver::setTimeLimit(std::chrono::milliseconds limit) {
+    m_timeLimit = limit;
+}
+
+SolverResult TetrisSolver::perfectClear(int maxPieces) {
+    m_perfect = true;
+    m_goalLines = 0;
+    m_maxPieces = maxPieces < 0 ? std::min(knownPieces(), TETRIS_SOLVER_HORIZON) : maxPieces;
+    start();
+
+    // Every perfect clear removes exactly (cells + 4*pieces)/width lines, and
+    // since the stack can't have holes spanning whole rows, no piece may ever
+    // stick out above that many rows. Try the lowest reachable heights first.
+    SolverResult res;
+    for(int h = std::max(1, visibleHeight(m_start)); h <= m_height && !m_timedOut; ++h) {
+        int need = m_width * h - m_start.m_cells;
+        if(need < 0 || need % 4 != 0 || need / 4 > m_maxPieces)
+            continue;
+        m_heightLimit = h;
+        auto cur = run();
+        res.m_visited += cur.m_visited;
+        res.m_memoryCapped |= cur.m_memoryCapped;
+        res.m_timedOut |= cur.m_timedOut;
+        if(cur.m_found) {
+            cur.m_visited = res.m_visited;
+            cur.m_memoryCapped = res.m_memoryCapped;
+            return cur;
+        }
+    }
+    return res;
+}
+
+SolverResult TetrisSolver::clearLines(int lines, int maxPieces) {
+    m_perfect = false;
+    m_goalLines = lines;
+    m_heightLimit = m_height + 4;
+    m_maxPieces = maxPieces < 0 ? std::min(knownPieces(), TETRIS_SOLVER_HORIZON) : maxPieces;
+    start();
+    return run();
+}
+
+void TetrisSolver::start() {
+    m_deadline = std::chrono::steady_clock::now() + m_timeLimit;
+    m_timedOut = false;
+}
+
+SolverResult TetrisSolver::run() {
+    SolverResult res;
+    for(auto& shard : m_shards)
+        std::unordered_set<uint64_t>().swap(shard.m_set);
+    m_memory = 0;
+    m_visited = 0;
+    m_capped = false;
+    m_solution.clear();
+
+    Scratch main;
+    prepare(main);
+    Node& root = main.m_nodes[0];
+    root.m_board = m_start;
+    root.m_state = State{0, m_startType, m_startHold, 0};
+    root.m_state.m_missing = missing(root.m_board, root.m_state);
+    root.m_state.m_hash = hash(root.m_board, root.m_state);
+    // An empty matrix is only worth reporting after putting something into it
+    if(!m_perfect && goal(root.m_board, root.m_state)) {
+        res.m_found = true;
+        return res;
+    }
+    if(m_maxPieces <= 0 || hopeless(root.m_state, 0))
+        return res;
+
+    std::vector<Child> tasks;
+    expand(root, 0, tasks, main);
+
+    // First placements are handed out to the workers, the lowest task that
+    // succeeds wins. Positions are only remembered once everything below them
+    // failed, so a task finds the same solution as it would on its own and,
+    // unless the time runs out, the answer doesn't depend on the scheduling.
+    m_bestTask = tasks.size();
+    std::atomic<size_t> next{0};
+    auto worker = [&](Scratch& s) {
+        std::vector<Step> path;
+        for(;;) {
+            size_t task = next++;
+            if(task >= tasks.size() || task > m_bestTask)
+                break;
+            apply(root, tasks[task], s.m_nodes[1]);
+            path.assign(1, tasks[task].m_step);
+            if(search(1, path, task, s)) {
+                std::lock_guard<std::mutex> lock(m_resultMutex);
+                if(task < m_bestTask) {
+                    m_bestTask = task;
+                    m_solution = path;
+                }
+                break;
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for(unsigned i = 1; i < std::min<size_t>(m_threads, tasks.size()); ++i) {
+        threads.emplace_back([&]() {
+            Scratch s;
+            prepare(s);
+            worker(s);
+        });
+    }
+    worker(main);
+    for(auto& t : threads)
+        t.join();
+
+    res.m_visited = m_visited;
+    res.m_memoryCapped = m_capped;
+    res.m_timedOut = m_timedOut;
+    if(m_bestTask >= tasks.size())
+        return res;
+
+    // Turn placements into key presses
+    Board board = m_start;
+    for(size_t k = 0; k < m_solution.size(); ++k) {
+        auto& step = m_solution[k];
+        SolverMove move;
+        move.m_hold = step.m_hold;
+        move.m_type = step.m_type;
+        move.m_x = step.m_place.m_x;
+        move.m_y = step.m_place.m_y;
+        move.m_rot = step.m_place.m_rot;
+        move.m_lines = step.m_lines;
+
+        Placement from = m_startPlace;
+        if(k != 0 || step.m_hold)
+            spawn(board, step.m_type, from);
+        if(step.m_hold)
+            move.m_acts.push_back(TetrisAct::hold);
+        // Can't happen unless the search and TetrisSim disagree on the rules,
+        // a solution that can't be played is no solution
+        if(!pathTo(board, step.m_type, from, step.m_place, move.m_acts)) {
+            res.m_moves.clear();
+            return res;
+        }
+        move.m_acts.push_back(TetrisAct::drop);
+
+        place(board, step.m_type, step.m_place);
+        res.m_moves.push_back(std::move(move));
+    }
+    res.m_found = true;
+    return res;
+}
+
+void TetrisSolver::prepare(Scratch& s) {
+    s.m_nodes.resize(m_maxPieces + 1);
+    s.m_children.resize(m_maxPieces + 1);
+}
+
+bool TetrisSolver::search(int depth, std::vector<Step>& path, size_t task, Scratch& s) {
+    Node& node = s.m_nodes[depth];
+    if(goal(node.m_board, node.m_state))
+        return true;
+    if(depth >= m_maxPieces || task > m_bestTask || expired())
+        return false;
+    if(hopeless(node.m_state, depth) || known(node.m_state.m_hash))
+        return false;
+    m_visited.fetch_add(1, std::memory_order_relaxed);
+
+    auto& children = s.m_children[depth];
+    expand(node, depth, children, s);
+    for(auto& child : children) {
+        apply(node, child, s.m_nodes[depth + 1]);
+        path.push_back(child.m_step);
+        if(search(depth + 1, path, task, s))
+            return true;
+        path.pop_back();
+    }
+
+    // Only a search that ran to the end tells that nothing is below
+    if(task <= m_bestTask && !m_timedOut)
+        remember(node.m_state.m_hash);
+    return false;
+}
+
+bool TetrisSolver::expired() {
+    if(m_timedOut)
+        return true;
+    if(m_timeLimit.count() == 0 || std::chrono::steady_clock::now() < m_deadline)
+        return false;
+    m_timedOut = true;
+    return true;
+}
+
+bool TetrisSolver::goal(const Board& b, const State& st) {
+    if(m_perfect)
+        return b.m_cells == 0;
+    return st.m_lines >= m_goalLines;
+}
+
+int TetrisSolver::knownPieces() {
+    return 1 + m_queue.size() + (m_startHold != -1);
+}
+
+bool TetrisSolver::hopeless(const State& st, int depth) {
+    // The held piece can always be swapped in for the first unknown one
+    int pieces = (st.m_cur != -1) + int(m_queue.size()) - st.m_queueN + (st.m_hold != -1);
+    int left = std::min(m_maxPieces - depth, pieces);
+    return st.m_missing > 4 * left;
+}
+
+int TetrisSolver::missing(const Board& b, const State& st) {
+    if(m_perfect) {
+        int band = m_heightLimit - st.m_lines;
+        auto& rows = b.m_rows;
+        // Columns filled up to the top of the band split it into parts that
+        // pieces can never cross, each of them has to be filled on its own.
+        uint64_t walls = m_fullRow;
+        for(int i = m_height + 4 - band; i < m_height + 4; ++i)
+            walls &= rows[i];
+        for(int x = 0; x < m_width;) {
+            uint64_t part = 0;
+            for(; x < m_width && !(walls & (1ull << x)); ++x)
+                part |= 1ull << x;
+            for(; x < m_width && (walls & (1ull << x)); ++x) {}
+            int empty = 0;
+            for(int i = m_height + 4 - band; i < m_height + 4; ++i)
+                empty += std::popcount(part & ~rows[i]);
+            if(empty % 4)
+                return m_width * m_height + 1;
+        }
+        return m_width * band - b.m_cells;
+    }
+
+    int rows[TETRIS_MATRIX_MAX_WIDTH + 1];
+    rowCounts(b, rows);
+    return fullest(rows, m_goalLines - st.m_lines);
+}
+
+void TetrisSolver::rowCounts(const Board& b, int* rows) {
+    // Rows above the stack are all empty
+    std::fill(rows, rows + m_width + 1, 0);
+    int top = m_height + 4 - visibleHeight(b);
+    rows[m_width] = std::max(0, top - 4);
+    for(int i = std::max(4, top); i < m_height + 4; ++i)
+        rows[m_width - std::popcount(b.m_rows[i])]++;
+}
+
+int TetrisSolver::fullest(const int* rows, int lines) {
+    // The fullest rows have to be completed with the pieces left
+    if(lines <= 0)
+        return 0;
+    if(lines > m_height)
+        return m_width * m_height + 1;
+    int need = 0;
+    for(int empty = 0; lines > 0; ++empty) {
+        int n = std::min(lines, rows[empty]);
+        need += n * empty;
+        lines -= n;
+    }
+    return need;
+}
+
+uint64_t TetrisSolver::hash(const Board& b, const State& st) {
+    uint64_t h = mix(mix(mix(st.m_queueN, st.m_cur), st.m_hold), st.m_lines);
+    // Rows above the stack are always empty, so where it starts is enough
+    int i = m_height + 4 - visibleHeight(b);
+    h = mix(h, i);
+    for(; i < m_height + 4; ++i)
+        h = mix(h, b.m_rows[i]);
+    return h;
+}
+
+// Only hashes are stored: collisions are rare enough at the sizes the
+// memory limit allows and keep entries small.
+bool TetrisSolver::known(uint64_t h) {
+    auto& shard = m_shards[h % TETRIS_SOLVER_SHARDS];
+    std::lock_guard<std::mutex> lock(shard.m_mutex);
+    return shard.m_set.contains(h);
+}
+
+void TetrisSolver::remember(uint64_t h) {
+    auto& shard = m_shards[h % TETRIS_SOLVER_SHARDS];
+    std::lock_guard<std::mutex> lock(shard.m_mutex);
+    auto& set = shard.m_set;
+
+    // The bucket array roughly doubles whenever the set outgrows it
+    size_t buckets = set.bucket_count();
+    size_t cost = TETRIS_SOLVER_NODE_BYTES;
+    if(set.size() + 1 > buckets * set.max_load_factor())
+        cost += buckets * sizeof(void*);
+    if(m_memory + cost > m_memoryLimit) {
+        m_capped = true;
+        return;
+    }
+    if(set.insert(h).second)
+        m_memory += TETRIS_SOLVER_NODE_BYTES + (set.bucket_count() - buckets) * sizeof(void*);
+}
+
+void TetrisSolver::expand(const Node& node, int depth, std::vector<Child>& out, Scratch& s) {
+    out.clear();
+    int lowest = m_perfect ? m_height + 4 - (m_heightLimit - node.m_state.m_lines) : 0;
+    int rows[TETRIS_MATRIX_MAX_WIDTH + 1];
+    if(!m_perfect)
+        rowCounts(node.m_board, rows);
+
+    for(int useHold = 0; useHold < 2; ++useHold) {
+        int type = node.m_state.m_cur;
+        int hold = node.m_state.m_hold;
+        int queueN = node.m_state.m_queueN;
+        Placement from = m_startPlace;
+
+        if(useHold) {
+            if(depth == 0 && m_holdLocked)
+                continue;
+            if(hold == -1) {
+                if(type == -1 || queueN >= int(m_queue.size()))
+                    continue;
+                hold = type;
+                type = m_queue[queueN++];
+            }
+            else {
+                // Past the preview the held piece goes in for one nobody
+                // knows, which can't be held again
+                std::swap(hold, type);
+            }
+        }
+        if(type == -1)
+            continue;
+        if((depth != 0 || useHold) && !spawn(node.m_board, type, from))
+            continue;
+
+        landings(node.m_board, type, from, s);
+        for(auto& p : s.m_places) {
+            auto& shape = m_shapes[p.m_rot][type];
+            if(4 + p.m_y + shape.m_minRow < lowest)
+                continue;
+
+            Child child{State{queueN, -1, hold, node.m_state.m_lines}, Step{bool(useHold), type, p, 0}};
+            if(queueN < int(m_queue.size()))
+                child.m_state.m_cur = m_queue[child.m_state.m_queueN++];
+
+            // Most children of the last levels can't make it, drop them
+            // before spending any more time on them. For lines only the rows
+            // the piece lands on change, so the parent's counts tell what is
+            // missing without placing it.
+            if(!m_perfect) {
+                std::copy_n(rows, m_width + 1, s.m_rows);
+                for(int i = std::max(shape.m_minRow, -p.m_y); i <= shape.m_maxRow; ++i) {
+                    uint64_t row = node.m_board.m_rows[4 + p.m_y + i];
+                    int before = m_width - std::popcount(row);
+                    int after = m_width - std::popcount(row | shifted(shape.m_rows[i], p.m_x));
+                    s.m_rows[before]--;
+                    s.m_rows[after ? after : m_width]++;
+                    child.m_step.m_lines += !after;
+                }
+                child.m_state.m_lines += child.m_step.m_lines;
+                child.m_state.m_missing = fullest(s.m_rows, m_goalLines - child.m_state.m_lines);
+                if(!goal(node.m_board, child.m_state) && hopeless(child.m_state, depth + 1))
+                    continue;
+            }
+
+            s.m_board.m_rows.assign(node.m_board.m_rows.begin(), node.m_board.m_rows.end());
+            s.m_board.m_cells = node.m_board.m_cells;
+            int lines = place(s.m_board, type, p);
+            if(m_perfect) {
+                child.m_step.m_lines = lines;
+                child.m_state.m_lines += lines;
+                child.m_state.m_missing = missing(s.m_board, child.m_state);
+                if(!goal(s.m_board, child.m_state) && hopeless(child.m_state, depth + 1))
+                    continue;
+            }
+            child.m_state.m_hash = hash(s.m_board, child.m_state);
+            out.push_back(child);
+        }
+    }
+
+    // Different rotations of symmetric pieces end up on the same cells,
+    // keep the first placement of every position
+    s.m_order.clear();
+    for(size_t i = 0; i < out.size(); ++i)
+        s.m_order.push_back({out[i].m_state.m_hash, i});
+    std::sort(s.m_order.begin(), s.m_order.end());
+    for(size_t i = 1; i < s.m_order.size(); ++i) {
+        if(s.m_order[i].first == s.m_order[i - 1].first)
+            out[s.m_order[i].second].m_state.m_missing = -1;
+    }
+    std::erase_if(out, [](auto& c) { return c.m_state.m_missing == -1; });
+
+    // Most promising first: fewest cells still missing, then the lowest placement
+    std::stable_sort(out.begin(), out.end(), [](auto& a, auto& b) {
+        if(a.m_state.m_missing != b.m_state.m_missing)
+            return a.m_state.m_missing < b.m_state.m_missing;
+        return a.m_step.m_place.m_y > b.m_step.m_place.m_y;
+    });
+}
+
+void TetrisSolver::apply(const Node& parent, const Child& child, Node& out) {
+    out.m_board.m_rows.assign(parent.m_board.m_rows.begin(), parent.m_board.m_rows.end());
+    out.m_board.m_cells = parent.m_board.m_cells;
+    place(out.m_board, child.m_step.m_type, child.m_step.m_place);
+    out.m_state = child.m_state;
+}
+
+bool TetrisSolver::check(const Board& b, int type, int x, int y, int rot) {
+    auto& s = m_shapes[rot][type];
+    if(x + s.m_minCol < 0 || x + s.m_maxCol >= m_width ||
+       y + s.m_minRow < -2 || y + s.m_maxRow >= m_height)
+        return false;
+    for(int i = s.m_minRow; i <= s.m_maxRow; ++i) {
+        if(b.m_rows[4 + y + i] & shifted(s.m_rows[i], x))
+            return false;
+    }
+    return true;
+}
+
+bool TetrisSolver::spawn(const Board& b, int type, Placement& p) {
+    // Same arithmetic as TetrisSim::newBlock()
+    p.m_y = -m_dims[type] / 2;
+    p.m_x = (m_width - m_dims[type])/2;
+    p.m_rot = 0;
+    return check(b, type, p.m_x, p.m_y, p.m_rot);
+}
+
+int TetrisSolver::place(Board& b, int type, const Placement& p) {
+    auto& s = m_shapes[p.m_rot][type];
+    for(int i = s.m_minRow; i <= s.m_maxRow; ++i) {
+        b.m_rows[4 + p.m_y + i] |= shifted(s.m_rows[i], p.m_x);
+        b.m_cells += std::popcount(s.m_rows[i]);
+    }
+
+    int lines = 0;
+    for(int i = 4 + std::max(0, p.m_y + s.m_minRow); i <= 4 + p.m_y + s.m_maxRow; ++i) {
+        if(b.m_rows[i] == m_fullRow) {
+            std::move_backward(b.m_rows.begin(), b.m_rows.begin() + i, b.m_rows.begin() + i + 1);
+            b.m_rows[0] = 0;
+            b.m_cells -= m_width;
+            lines++;
+        }
+    }
+    return lines;
+}
+
+bool TetrisSolver::fit(const Board& b, int type, int& x, int& y, int rot) {
+    // Same order as TetrisSim::tryPutting()
+    if(check(b, type, x, y, rot))
+        return true;
+    for(int i = 0; i < 3; ++i) {
+        for(int j = 0; j < 3; ++j) {
+            if(check(b, type, x + FIT_ORDER[j], y + FIT_ORDER[i], rot)) {
+                x += FIT_ORDER[j];
+                y += FIT_ORDER[i];
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+int TetrisSolver::visibleHeight(const Board& b) {
+    for(int i = 0; i < m_height + 4; ++i) {
+        if(b.m_rows[i])
+            return m_height + 4 - i;
+    }
+    return 0;
+}
+
+void TetrisSolver::landings(const Board& b, int type, const Placement& from, Scratch& s) {
+    s.m_places.clear();
+
+    // Everything above the stack is open: instead of walking the piece down
+    // row by row, start from every position right above the stack. Anything
+    // higher than that can't lead anywhere new.
+    int top = m_height - visibleHeight(b) - 4;
+    bool seeded = top > from.m_y;
+    if(!seeded)
+        top = -6;
+
+    // Positions are kept as one mask per row and rotation, bit n standing for
+    // the leftmost cell of the piece in column n, so a whole row of positions
+    // is moved at once. fits tells where the piece doesn't collide, rows
+    // top - 1 to m_height, the first one only matters for rotations kicking up.
+    const int NY = m_height - top + 2;
+    auto row = [&](int rot, int y) { return rot*NY + y - top + 1; };
+    s.m_fits.assign(4 * NY, 0);
+    s.m_reach.assign(4 * NY, 0);
+    for(int rot = 0; rot < 4; ++rot) {
+        auto& shape = m_shapes[rot][type];
+        int span = m_width - (shape.m_maxCol - shape.m_minCol);
+        uint64_t inside = span == 64 ? ~0ull : (1ull << span) - 1;
+        for(int y = top - 1; y <= m_height; ++y) {
+            if(y + shape.m_minRow < -2 || y + shape.m_maxRow >= m_height)
+                continue;
+            uint64_t fits = inside;
+            for(int i = shape.m_minRow; i <= shape.m_maxRow; ++i) {
+                uint64_t filled = b.m_rows[4 + y + i];
+                for(uint64_t cells = shape.m_rows[i] >> shape.m_minCol; cells; cells &= cells - 1)
+                    fits &= ~(filled >> std::countr_zero(cells));
+            }
+            s.m_fits[row(rot, y)] = fits;
+        }
+    }
+
+    s.m_work.clear();
+    auto visit = [&](int k, uint64_t bits) {
+        bits &= ~s.m_reach[k];
+        if(bits) {
+            s.m_reach[k] |= bits;
+            s.m_work.push_back(k);
+        }
+    };
+    if(seeded) {
+        for(int rot = 0; rot < 4; ++rot)
+            visit(row(rot, top), s.m_fits[row(rot, top)]);
+    }
+    else {
+        visit(row(from.m_rot, from.m_y), 1ull << (from.m_x + m_shapes[from.m_rot][type].m_minCol));
+    }
+
+    while(!s.m_work.empty()) {
+        int k = s.m_work.back();
+        s.m_work.pop_back();
+        int rot = k / NY;
+        int y = k % NY + top - 1;
+
+        uint64_t fits = s.m_fits[k];
+        uint64_t reach = s.m_reach[k];
+        for(uint64_t prev = 0; prev != reach;) {
+            prev = reach;
+            reach |= ((reach << 1) | (reach >> 1)) & fits;
+        }
+        s.m_reach[k] = reach;
+        visit(k + 1, reach & s.m_fits[k + 1]);
+
+        // Rotations try the offsets in the order of fit(), every position
+        // takes the first one that fits
+        for(int turn : {1, 3}) {
+            int to = (rot + turn) % 4;
+            int shift = m_shapes[to][type].m_minCol - m_shapes[rot][type].m_minCol;
+            uint64_t left = reach;
+            for(int i = 0; i < 3 && left; ++i) {
+                int ty = y + FIT_ORDER[i];
+                for(int j = 0; j < 3 && left; ++j) {
+                    int d = FIT_ORDER[j] + shift;
+                    uint64_t moved = left & shifted(s.m_fits[row(to, ty)], -d);
+                    left &= ~moved;
+                    if(ty >= top)
+                        visit(row(to, ty), shifted(moved, d));
+                }
+            }
+        }
+    }
+
+    for(int rot = 0; rot < 4; ++rot) {
+        int minCol = m_shapes[rot][type].m_minCol;
+        for(int y = top; y < m_height; ++y) {
+            uint64_t landed = s.m_reach[row(rot, y)] & ~s.m_fits[row(rot, y + 1)];
+            for(; landed; landed &= landed - 1)
+                s.m_places.push_back({std::countr_zero(landed) - minCol, y, rot});
+        }
+    }
+}
+
+bool TetrisSolver::pathTo(const Board& b, int type, const Placement& from, const Placement& to, std::vector<TetrisAct>& acts) {
+    // Plain search over single moves, remembering how every position was reached.
+    // x in [-4, width + 4), y in [-6, height)
+    const int NX = m_width + 8;
+    const int NY = m_height + 6;
+    auto index = [&](int x, int y, int rot) { return (rot*NY + y + 6)*NX + x + 4; };
+
+    std::vector<int> parent(NX * NY * 4, -1);
+    std::vector<Placement> queue;
+    auto visit = [&](int x, int y, int rot, int prev, TetrisAct a) {
+        auto i = index(x, y, rot);
+        if(parent[i] != -1)
+            return;
+        parent[i] = prev * 8 + int(a);
+        queue.push_back({x, y, rot});
+    };
+    int start = index(from.m_x, from.m_y, from.m_rot);
+    visit(from.m_x, from.m_y, from.m_rot, start, TetrisAct::drop);
+
+    for(size_t k = 0; k < queue.size(); ++k) {
+        auto p = queue[k];
+        int cur = index(p.m_x, p.m_y, p.m_rot);
+        if(check(b, type, p.m_x - 1, p.m_y, p.m_rot))
+            visit(p.m_x - 1, p.m_y, p.m_rot, cur, TetrisAct::left);
+        if(check(b, type, p.m_x + 1, p.m_y, p.m_rot))
+            visit(p.m_x + 1, p.m_y, p.m_rot, cur, TetrisAct::right);
+        if(check(b, type, p.m_x, p.m_y + 1, p.m_rot))
+            visit(p.m_x, p.m_y + 1, p.m_rot, cur, TetrisAct::down);
+
+        int x = p.m_x, y = p.m_y;
+        if(fit(b, type, x, y, (p.m_rot + 1)%4))
+            visit(x, y, (p.m_rot + 1)%4, cur, TetrisAct::clockwise);
+        x = p.m_x, y = p.m_y;
+        if(fit(b, type, x, y, (p.m_rot + 3)%4))
+            visit(x, y, (p.m_rot + 3)%4, cur, TetrisAct::counterClockwise);
+    }
+
+    int i = index(to.m_x, to.m_y, to.m_rot);
+    if(parent[i] == -1)
+        return false;
+
+    std::vector<TetrisAct> path;
+    while(i != start) {
+        path.push_back(TetrisAct(parent[i] % 8));
+        i = parent[i] / 8;
+    }
+    acts.insert(acts.end(), path.rbegin(), path.rend());
+    return true;
+}